@@ -15,12 +15,20 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
 #include "TLC5947.h"
 
 #define CHANNELS        24
 #define GET_CHANNEL(i)  (i) % CHANNELS
 #define GET_CHIP(i)     ((i) - ((i) % CHANNELS)) / CHANNELS
 
+// Apply a calibration scale to a value. A scale of all ones leaves the value
+// untouched.
+static inline uint16_t calibrated(uint16_t value, tlc_cal_t scale) {
+  return ((uint32_t)value * ((uint32_t)scale + 1)) >> TLC5947_CALIBRATION_SHIFT;
+}
+
 // Static variable definitions
 // Shared SPI pins
 const pin_t TLC5947::s_SCK = SPI_SCK;
@@ -36,6 +44,8 @@ bool TLC5947::s_SPIenabled = false;
 uint8_t TLC5947::s_numChips = 0;
 // Array for all channel values
 uint16_t** TLC5947::s_values;
+// Per-chip calibration scales (0 if a chip is uncalibrated)
+tlc_cal_t** TLC5947::s_scales;
 
 TLC5947::TLC5947() : TLC5947(s_latch[0], s_blank[0]) {
   // TODO: warn the user if they don't initialize the first chip
@@ -96,6 +106,7 @@ void TLC5947::embiggen(void) {
     for (uint8_t i = 0; i < s_numChips + 1; i++) {
       s_valuesTemp[i] = new uint16_t[CHANNELS];
     }
+    tlc_cal_t **s_scalesTemp = new tlc_cal_t*[s_numChips + 1];
     pin_t *s_latchTemp = new pin_t[s_numChips + 1];
     pin_t *s_blankTemp = new pin_t[s_numChips + 1];
 
@@ -105,24 +116,29 @@ void TLC5947::embiggen(void) {
         s_valuesTemp[i][ii] = s_values[i][ii];
       }
 
+      s_scalesTemp[i] = s_scales[i];
       s_latchTemp[i] = s_latch[i];
       s_blankTemp[i] = s_blank[i];
     }
+    s_scalesTemp[s_numChips] = 0;
 
     // Delete the old dynamic multidimensional arrays
     for (uint8_t i = 0; i < s_numChips; i++) {
       delete[] s_values[i];
     }
     delete[] s_values;
+    delete[] s_scales;
     delete[] s_latch;
     delete[] s_blank;
 
     // Point the old arrays at the new array locations
     s_values = s_valuesTemp;
+    s_scales = s_scalesTemp;
     s_latch = s_latchTemp;
     s_blank = s_blankTemp;
     // Nullify the temporary pointers
     s_valuesTemp = 0;
+    s_scalesTemp = 0;
     s_latchTemp = 0;
     s_blankTemp = 0;
   } else {
@@ -131,6 +147,8 @@ void TLC5947::embiggen(void) {
     for (uint8_t i = 0; i < s_numChips + 1; i++) {
       s_values[i] = new uint16_t[CHANNELS];
     }
+    s_scales = new tlc_cal_t*[1];
+    s_scales[0] = 0;
 
     s_latch = new pin_t;
     s_blank = new pin_t;
@@ -238,6 +256,34 @@ void TLC5947::clearAll(void) {
   }
 }
 
+void TLC5947::calibrateProgmem(const tlc_cal_t *table) {
+  if (!s_scales[m_chip]) {
+    s_scales[m_chip] = new tlc_cal_t[CHANNELS];
+  }
+
+  // Copy the table out of flash so that send() doesn't have to read it
+  memcpy_P(s_scales[m_chip], table, CHANNELS * sizeof(tlc_cal_t));
+  s_modified = true;
+}
+
+void TLC5947::calibrateEEPROM(const tlc_cal_t *table) {
+  if (!s_scales[m_chip]) {
+    s_scales[m_chip] = new tlc_cal_t[CHANNELS];
+  }
+
+  // Copy the table out of EEPROM so that send() doesn't have to read it
+  eeprom_read_block(s_scales[m_chip], table, CHANNELS * sizeof(tlc_cal_t));
+  s_modified = true;
+}
+
+void TLC5947::uncalibrate(void) {
+  if (s_scales[m_chip]) {
+    delete[] s_scales[m_chip];
+    s_scales[m_chip] = 0;
+    s_modified = true;
+  }
+}
+
 void TLC5947::enableSPI() {
   // Set MOSI and SCK as outputs
   *s_SCK.ddr |= _BV(s_SCK.pin);
@@ -297,20 +343,37 @@ void TLC5947::latch(uint8_t chip) {
 }
 
 void TLC5947::send(void) {
-  // Shift the data out to the chips
-  for (int16_t i = (s_numChips * CHANNELS) - 1; i >= 0; i -= 2) {
-    // Break every two channels into 3 bytes and send them
-    while(!(SPSR & (1<<SPIF)));
-    SPDR = (uint8_t)((s_values[GET_CHIP(i)][GET_CHANNEL(i)] >> 4) & 0x00FF);
-    while(!(SPSR & (1<<SPIF)));
-    SPDR = (uint8_t)((s_values[GET_CHIP(i)][GET_CHANNEL(i)] << 4) & 0x00F0) |
-      (uint8_t)((s_values[GET_CHIP(i - 1)][GET_CHANNEL(i - 1)] >> 8) & 0x000F);
-    while(!(SPSR & (1<<SPIF)));
-    SPDR = (uint8_t)(s_values[GET_CHIP(i - 1)][GET_CHANNEL(i - 1)] & 0x00FF);
+  // Shift the data out to the chips, last chip first
+  for (int16_t chip = s_numChips - 1; chip >= 0; chip--) {
+    uint16_t *values = s_values[chip];
+    tlc_cal_t *scales = s_scales[chip];
+
+    for (int8_t i = CHANNELS - 1; i >= 0; i -= 2) {
+      uint16_t high = values[i];
+      uint16_t low = values[i - 1];
+
+      // Apply calibration while packing, so read() still returns the
+      // uncorrected values
+      if (scales) {
+        high = calibrated(high, scales[i]);
+        low = calibrated(low, scales[i - 1]);
+      }
+
+      // Break every two channels into 3 bytes and send them
+      while(!(SPSR & (1<<SPIF)));
+      SPDR = (uint8_t)((high >> 4) & 0x00FF);
+      while(!(SPSR & (1<<SPIF)));
+      SPDR = (uint8_t)((high << 4) & 0x00F0) | (uint8_t)((low >> 8) & 0x000F);
+      while(!(SPSR & (1<<SPIF)));
+      SPDR = (uint8_t)(low & 0x00FF);
+    }
   }
 }
 
 void TLC5947::update(void) {
+  // Composite any layers that have changed into the chain
+  TLC5947Layer::flatten();
+
   // TODO: weed out duplicate calls to disable(), enable(), and latch()
   if (s_modified) {
     // Enable SPI if it isn't already on
@@ -372,38 +435,53 @@ void TLC5947::shift(uint16_t shift, uint16_t value) {
     disable(i);
   }
 
-  // Actually shift the data out to the chips
-  for (int16_t i = shift - 1; i >= 0; i -= 2) {
-    if (i == 0) {
-      // If we are shifting an odd number of channels, we no longer have a
-      // nice whole number of bytes. For the last channel, we have to send
-      // a byte and a nibble.
-      while(!(SPSR & (1<<SPIF)));
-      SPDR = (uint8_t)((p_values[i] >> 4) & 0x00FF);
+  // Check whether any chip is calibrated
+  bool isCalibrated = false;
+  for (uint8_t i = 0; i < s_numChips; i++) {
+    if (s_scales[i]) {
+      isCalibrated = true;
+    }
+  }
 
-      // TODO: figure out how to properly transfer the last nibble (4 bits)
-      while(!(SPSR & (1<<SPIF)));
-      for (uint8_t ii = 0; ii < 4; ii++) {
-        // Send the current bit
-        if (((p_values[i] & 0x000F)<<ii) & (1<<3)) {
-          *s_MOSI.port |= _BV(s_MOSI.pin);
-        } else {
-          *s_MOSI.port &= ~(_BV(s_MOSI.pin));
+  if (isCalibrated) {
+    // The data already in the chips was scaled for the channels it came from,
+    // so shifting it along would leave it scaled for the wrong channels.
+    // Send the whole rotated chain instead.
+    send();
+  } else {
+    // Actually shift the data out to the chips
+    for (int16_t i = shift - 1; i >= 0; i -= 2) {
+      if (i == 0) {
+        // If we are shifting an odd number of channels, we no longer have a
+        // nice whole number of bytes. For the last channel, we have to send
+        // a byte and a nibble.
+        while(!(SPSR & (1<<SPIF)));
+        SPDR = (uint8_t)((p_values[i] >> 4) & 0x00FF);
+
+        // TODO: figure out how to properly transfer the last nibble (4 bits)
+        while(!(SPSR & (1<<SPIF)));
+        for (uint8_t ii = 0; ii < 4; ii++) {
+          // Send the current bit
+          if (((p_values[i] & 0x000F)<<ii) & (1<<3)) {
+            *s_MOSI.port |= _BV(s_MOSI.pin);
+          } else {
+            *s_MOSI.port &= ~(_BV(s_MOSI.pin));
+          }
+
+          // Clock in the current bit (serial clock) [rising edge]
+          *s_SCK.port |= _BV(s_SCK.pin);
+          *s_SCK.port &= ~(_BV(s_SCK.pin));
         }
-
-        // Clock in the current bit (serial clock) [rising edge]
-        *s_SCK.port |= _BV(s_SCK.pin);
-        *s_SCK.port &= ~(_BV(s_SCK.pin));
+      } else {
+        // Break every two channels into 3 bytes and send them
+        while(!(SPSR & (1<<SPIF)));
+        SPDR = (uint8_t)((p_values[i] >> 4) & 0x00FF);
+        while(!(SPSR & (1<<SPIF)));
+        SPDR = (uint8_t)((p_values[i] << 4) & 0x00F0) |
+          (uint8_t)((p_values[i - 1] >> 8) & 0x000F);
+        while(!(SPSR & (1<<SPIF)));
+        SPDR = (uint8_t)(p_values[i - 1] & 0x00FF);
       }
-    } else {
-      // Break every two channels into 3 bytes and send them
-      while(!(SPSR & (1<<SPIF)));
-      SPDR = (uint8_t)((p_values[i] >> 4) & 0x00FF);
-      while(!(SPSR & (1<<SPIF)));
-      SPDR = (uint8_t)((p_values[i] << 4) & 0x00F0) |
-        (uint8_t)((p_values[i - 1] >> 8) & 0x000F);
-      while(!(SPSR & (1<<SPIF)));
-      SPDR = (uint8_t)(p_values[i - 1] & 0x00FF);
     }
   }
 
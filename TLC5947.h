@@ -21,6 +21,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <avr/io.h>
 #include "pindefs.h"
 #include "new.h"
+#include "TLC5947Layer.h"
+
+// Calibration scales are 8bit by default. Define TLC5947_CALIBRATION_16BIT as
+// a compiler flag (so the library and sketch agree) for finer 16bit scales.
+#if defined (TLC5947_CALIBRATION_16BIT)
+typedef uint16_t tlc_cal_t;
+#  define TLC5947_CALIBRATION_SHIFT 16
+#else
+typedef uint8_t tlc_cal_t;
+#  define TLC5947_CALIBRATION_SHIFT 8
+#endif
 
 // Declare TLC5947 class and its member functions
 class TLC5947 {
@@ -42,6 +53,10 @@ class TLC5947 {
     void clear(void);
     static void clearAll(void);
 
+    void calibrateProgmem(const tlc_cal_t *table);
+    void calibrateEEPROM(const tlc_cal_t *table);
+    void uncalibrate(void);
+
     static void enableSPI(void);
     static void disableSPI(void);
 
@@ -55,6 +70,8 @@ class TLC5947 {
     static void shift(uint16_t shift = 1, uint16_t value = 0xFFFF);
 
   private:
+    friend class TLC5947Layer;
+
     static void embiggen(void);
 
     static void enable(uint8_t chip);
@@ -71,6 +88,7 @@ class TLC5947 {
 
     static uint8_t s_numChips;
     static uint16_t **s_values;
+    static tlc_cal_t **s_scales;
 
     uint8_t m_chip;
 };
@@ -0,0 +1,236 @@
+/*
+Copyright 2015 Jordi Pakey-Rodriguez <jordi.orlando@hexa.io>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <util/atomic.h>
+#include "TLC5947.h"
+#include "TLC5947Layer.h"
+
+#define CHANNELS        24
+#define GET_CHANNEL(i)  (i) % CHANNELS
+#define GET_CHIP(i)     ((i) - ((i) % CHANNELS)) / CHANNELS
+
+// Static variable definitions
+// Bottom layer of the stack
+TLC5947Layer* TLC5947Layer::s_first = 0;
+
+TLC5947Layer::TLC5947Layer(uint16_t start, uint16_t span, blend_t blend,
+  uint8_t opacity) {
+  m_next = 0;
+  m_start = start;
+  m_span = span;
+  m_blend = blend;
+  m_opacity = opacity;
+
+  // Set all channels to start at 0
+  m_values = new uint16_t[m_span];
+  for (uint16_t i = 0; i < m_span; i++) {
+    m_values[i] = 0;
+  }
+
+  // The whole span is now owned by the compositor. This has to be set up
+  // before the layer is linked in, since update() may run from an interrupt.
+  m_dirtyFirst = 0xFFFF;
+  m_dirtyLast = 0;
+  if (m_span) {
+    touch(0, m_span - 1);
+  }
+
+  // Add this layer to the top of the stack
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (s_first) {
+      TLC5947Layer *p_layer = s_first;
+      while (p_layer->m_next) {
+        p_layer = p_layer->m_next;
+      }
+      p_layer->m_next = this;
+    } else {
+      s_first = this;
+    }
+  }
+}
+
+TLC5947Layer::~TLC5947Layer() {
+  // Remove this layer from the stack
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (s_first == this) {
+      s_first = m_next;
+    } else {
+      TLC5947Layer *p_layer = s_first;
+      while (p_layer && p_layer->m_next != this) {
+        p_layer = p_layer->m_next;
+      }
+      if (p_layer) {
+        p_layer->m_next = m_next;
+      }
+    }
+  }
+
+  // Recomposite the channels that this layer used to cover. One channel at a
+  // time, so that interrupts aren't held off for the whole span.
+  for (uint16_t i = 0; i < m_span; i++) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      write(m_start + i);
+    }
+  }
+
+  delete[] m_values;
+}
+
+uint16_t TLC5947Layer::read(uint16_t channel) {
+  // Return the given channel
+  if (channel < m_span) {
+    return m_values[channel];
+  }
+
+  return 0;
+}
+
+void TLC5947Layer::set(uint16_t value) {
+  // 12bit resolution means a maximum of 4095
+  value &= 0x0FFF;
+
+  // Set all channels to value
+  for (uint16_t i = 0; i < m_span; i++) {
+    if (m_values[i] != value) {
+      // update() may be compositing from the scheduler interrupt
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        m_values[i] = value;
+        touch(i, i);
+      }
+    }
+  }
+}
+
+void TLC5947Layer::set(uint16_t channel, uint16_t value) {
+  // 12bit resolution means a maximum of 4095
+  value &= 0x0FFF;
+
+  // Set the given channel to value
+  if (channel < m_span && m_values[channel] != value) {
+    // update() may be compositing from the scheduler interrupt
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      m_values[channel] = value;
+      touch(channel, channel);
+    }
+  }
+}
+
+void TLC5947Layer::clear(void) {
+  set(0);
+}
+
+void TLC5947Layer::setOpacity(uint8_t opacity) {
+  if (m_opacity != opacity && m_span) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      m_opacity = opacity;
+      touch(0, m_span - 1);
+    }
+  }
+}
+
+void TLC5947Layer::setBlend(blend_t blend) {
+  if (m_blend != blend && m_span) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      m_blend = blend;
+      touch(0, m_span - 1);
+    }
+  }
+}
+
+void TLC5947Layer::touch(uint16_t first, uint16_t last) {
+  // Grow the dirty range to include [first, last]. Both ends have to change
+  // together, or flatten() could run in between and lose the change.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (first < m_dirtyFirst) {
+      m_dirtyFirst = first;
+    }
+    if (last > m_dirtyLast) {
+      m_dirtyLast = last;
+    }
+  }
+}
+
+uint16_t TLC5947Layer::blend(uint16_t below, uint16_t value) {
+  // Map opacity from [0, 255] to [0, 256] so that both ends are exact
+  uint16_t alpha = m_opacity + (m_opacity >> 7);
+  uint16_t weighted = ((uint32_t)value * alpha) >> 8;
+
+  switch (m_blend) {
+    case BLEND_ADD:
+      // Saturate at 4095
+      return (below + weighted > 0x0FFF) ? 0x0FFF : below + weighted;
+    case BLEND_MAX:
+      return (weighted > below) ? weighted : below;
+    case BLEND_ALPHA:
+    default:
+      return ((uint32_t)value * alpha + (uint32_t)below * (256 - alpha)) >> 8;
+  }
+}
+
+uint16_t TLC5947Layer::composite(uint16_t channel) {
+  // Blend every layer covering channel, from the bottom of the stack up
+  uint16_t value = 0;
+  for (TLC5947Layer *p_layer = s_first; p_layer; p_layer = p_layer->m_next) {
+    if (channel >= p_layer->m_start &&
+      channel < p_layer->m_start + p_layer->m_span) {
+      value = p_layer->blend(value, p_layer->m_values[channel - p_layer->m_start]);
+    }
+  }
+
+  return value;
+}
+
+void TLC5947Layer::write(uint16_t channel) {
+  // Ignore channels past the end of the chain
+  if (channel >= TLC5947::s_numChips * CHANNELS) {
+    return;
+  }
+
+  uint16_t value = composite(channel);
+  if (TLC5947::s_values[GET_CHIP(channel)][GET_CHANNEL(channel)] != value) {
+    TLC5947::s_values[GET_CHIP(channel)][GET_CHANNEL(channel)] = value;
+    TLC5947::s_modified = true;
+  }
+}
+
+void TLC5947Layer::flatten(void) {
+  // Only recomposite the dirty ranges of each layer
+  for (TLC5947Layer *p_layer = s_first; p_layer; p_layer = p_layer->m_next) {
+    if (p_layer->m_dirtyFirst > p_layer->m_dirtyLast) {
+      continue;
+    }
+
+    uint16_t i;
+    for (i = p_layer->m_dirtyFirst; i <= p_layer->m_dirtyLast; i++) {
+      // Channels past the end of the chain stay dirty until the chips that
+      // hold them have been declared
+      if (p_layer->m_start + i >= TLC5947::s_numChips * CHANNELS) {
+        break;
+      }
+
+      write(p_layer->m_start + i);
+    }
+
+    if (i > p_layer->m_dirtyLast) {
+      // Mark the layer as clean
+      p_layer->m_dirtyFirst = 0xFFFF;
+      p_layer->m_dirtyLast = 0;
+    } else {
+      p_layer->m_dirtyFirst = i;
+    }
+  }
+}
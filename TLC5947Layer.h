@@ -0,0 +1,70 @@
+/*
+Copyright 2015 Jordi Pakey-Rodriguez <jordi.orlando@hexa.io>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TLC5947LAYER_H
+#define TLC5947LAYER_H
+
+#include <stdint.h>
+
+// Declare TLC5947Layer class and its member functions
+class TLC5947Layer {
+  public:
+    enum blend_t {
+      BLEND_ADD,
+      BLEND_MAX,
+      BLEND_ALPHA
+    };
+
+    TLC5947Layer(uint16_t start, uint16_t span, blend_t blend = BLEND_ALPHA,
+      uint8_t opacity = 255);
+    ~TLC5947Layer();
+
+    uint16_t read(uint16_t channel);
+
+    void set(uint16_t value);
+    void set(uint16_t channel, uint16_t value);
+
+    void clear(void);
+
+    void setOpacity(uint8_t opacity);
+    void setBlend(blend_t blend);
+
+    static void flatten(void);
+
+  private:
+    void touch(uint16_t first, uint16_t last);
+    uint16_t blend(uint16_t below, uint16_t value);
+
+    static uint16_t composite(uint16_t channel);
+    static void write(uint16_t channel);
+
+    static TLC5947Layer *s_first;
+    TLC5947Layer *m_next;
+
+    uint16_t m_start;
+    uint16_t m_span;
+    uint16_t *m_values;
+
+    blend_t m_blend;
+    uint8_t m_opacity;
+
+    // Dirty range in layer channels [m_dirtyFirst, m_dirtyLast]
+    uint16_t m_dirtyFirst;
+    uint16_t m_dirtyLast;
+};
+
+#endif
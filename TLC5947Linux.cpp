@@ -0,0 +1,327 @@
+/*
+Copyright 2015 Jordi Pakey-Rodriguez <jordi.orlando@hexa.io>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TLC5947Linux.h"
+
+#if defined (__linux__)
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#define CHANNELS        24
+#define FRAME_BYTES     36
+#define SPIDEV_BUFSIZ   "/sys/module/spidev/parameters/bufsiz"
+
+// Returns the request index of offset, adding it to offsets if needed
+static int8_t lineIndex(uint32_t *offsets, uint8_t *numLines, uint32_t offset) {
+  for (uint8_t i = 0; i < *numLines; i++) {
+    if (offsets[i] == offset) {
+      return i;
+    }
+  }
+
+  if (*numLines >= GPIO_V2_LINES_MAX) {
+    return -1;
+  }
+
+  offsets[*numLines] = offset;
+  return (*numLines)++;
+}
+
+// Anything that isn't a character device (a regular file, a FIFO, a socket)
+// is treated as a stand-in for the real device so the backend can be tested
+// without any hardware attached.
+static bool isFake(int fd) {
+  struct stat st;
+
+  if (fstat(fd, &st) < 0) {
+    return false;
+  }
+
+  return !S_ISCHR(st.st_mode);
+}
+
+// Returns the largest message spidev will accept (its bufsiz parameter)
+static uint32_t spidevBufsiz(void) {
+  uint32_t bufsiz = 0;
+  char buffer[16];
+
+  int fd = open(SPIDEV_BUFSIZ, O_RDONLY);
+  if (fd >= 0) {
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    for (ssize_t i = 0; i < length && buffer[i] >= '0' && buffer[i] <= '9'; i++) {
+      bufsiz = (bufsiz * 10) + (buffer[i] - '0');
+    }
+    close(fd);
+  }
+
+  // Fall back to the spidev default
+  return bufsiz ? bufsiz : 4096;
+}
+
+TLC5947Linux::TLC5947Linux(const char *spidev, const char *gpiochip,
+  uint8_t numChips, const uint32_t *latch, const uint32_t *blank,
+  uint32_t speed) {
+  m_spiFd = -1;
+  m_gpioFd = -1;
+  m_spiFake = false;
+  m_gpioFake = false;
+  m_speed = speed;
+  m_bufsiz = 0;
+  m_latchMask = 0;
+  m_blankMask = 0;
+  m_modified = true;
+  m_numChips = numChips;
+
+  // Allocate the channel values and the packed frame
+  m_values = new uint16_t[m_numChips * CHANNELS];
+  m_frame = new uint8_t[m_numChips * FRAME_BYTES];
+  for (uint16_t i = 0; i < m_numChips * CHANNELS; i++) {
+    m_values[i] = 0;
+  }
+
+  // Collect every XLAT and BLANK line into a single line request. Chips that
+  // share a line only request it once.
+  struct gpio_v2_line_request req;
+  memset(&req, 0, sizeof(req));
+  uint8_t numLines = 0;
+  for (uint8_t i = 0; i < m_numChips; i++) {
+    int8_t l = lineIndex(req.offsets, &numLines, latch[i]);
+    int8_t b = lineIndex(req.offsets, &numLines, blank[i]);
+    if (l < 0 || b < 0) {
+      return;
+    }
+
+    m_latchMask |= (uint64_t)1 << l;
+    m_blankMask |= (uint64_t)1 << b;
+  }
+
+  // Open the SPI device
+  m_spiFd = open(spidev, O_RDWR);
+  if (m_spiFd < 0) {
+    return;
+  }
+  m_spiFake = isFake(m_spiFd);
+
+  if (!m_spiFake) {
+    // Mode 0, MSB first, 8 bits per word
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    if (ioctl(m_spiFd, SPI_IOC_WR_MODE, &mode) < 0 ||
+      ioctl(m_spiFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+      ioctl(m_spiFd, SPI_IOC_WR_MAX_SPEED_HZ, &m_speed) < 0) {
+      close(m_spiFd);
+      m_spiFd = -1;
+      return;
+    }
+
+    m_bufsiz = spidevBufsiz();
+  }
+
+  // Open the GPIO chip
+  int chipFd = open(gpiochip, O_RDWR);
+  if (chipFd < 0) {
+    close(m_spiFd);
+    m_spiFd = -1;
+    return;
+  }
+  m_gpioFake = isFake(chipFd);
+
+  if (m_gpioFake) {
+    // Line state changes get written straight to the stand-in
+    m_gpioFd = chipFd;
+  } else {
+    // Request all lines as outputs with BLANK high and XLAT low
+    strncpy(req.consumer, "TLC5947", sizeof(req.consumer) - 1);
+    req.num_lines = numLines;
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values = m_blankMask;
+    req.config.attrs[0].mask = m_latchMask | m_blankMask;
+
+    int ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chipFd);
+    if (ret < 0) {
+      close(m_spiFd);
+      m_spiFd = -1;
+      return;
+    }
+    m_gpioFd = req.fd;
+  }
+
+  // Set all channels to start at 0
+  disable();
+  setLines(m_latchMask, 0);
+  update();
+  enable();
+}
+
+TLC5947Linux::~TLC5947Linux() {
+  if (m_gpioFd >= 0) {
+    // Blank the outputs before releasing the lines
+    disable();
+    close(m_gpioFd);
+  }
+  if (m_spiFd >= 0) {
+    close(m_spiFd);
+  }
+
+  delete[] m_values;
+  delete[] m_frame;
+}
+
+bool TLC5947Linux::isOpen(void) {
+  return m_spiFd >= 0 && m_gpioFd >= 0;
+}
+
+uint8_t TLC5947Linux::numChips(void) {
+  return m_numChips;
+}
+
+uint16_t TLC5947Linux::read(uint16_t channel) {
+  // Return the given channel
+  if (channel < m_numChips * CHANNELS) {
+    return m_values[channel];
+  }
+
+  return 0;
+}
+
+void TLC5947Linux::set(uint16_t channel, uint16_t value) {
+  // 12bit resolution means a maximum of 4095
+  value &= 0x0FFF;
+
+  // Set the given channel to value
+  if (channel < m_numChips * CHANNELS && m_values[channel] != value) {
+    m_values[channel] = value;
+    m_modified = true;
+  }
+}
+
+void TLC5947Linux::setAll(uint16_t value) {
+  // 12bit resolution means a maximum of 4095
+  value &= 0x0FFF;
+
+  // Set all chips to value
+  for (uint16_t i = 0; i < m_numChips * CHANNELS; i++) {
+    if (m_values[i] != value) {
+      m_values[i] = value;
+      m_modified = true;
+    }
+  }
+}
+
+void TLC5947Linux::clearAll(void) {
+  setAll(0);
+}
+
+bool TLC5947Linux::setLines(uint64_t mask, uint64_t bits) {
+  if (m_gpioFd < 0) {
+    return false;
+  }
+
+  struct gpio_v2_line_values values;
+  values.bits = bits;
+  values.mask = mask;
+
+  if (m_gpioFake) {
+    return write(m_gpioFd, &values, sizeof(values)) == sizeof(values);
+  }
+
+  return ioctl(m_gpioFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) >= 0;
+}
+
+bool TLC5947Linux::enable(void) {
+  // Enable all outputs (BLANK low)
+  return setLines(m_blankMask, 0);
+}
+
+bool TLC5947Linux::disable(void) {
+  // Disable all outputs (BLANK high)
+  return setLines(m_blankMask, m_blankMask);
+}
+
+bool TLC5947Linux::latch(void) {
+  // Latch the data to the outputs (rising edge of XLAT on every chip)
+  return setLines(m_latchMask, m_latchMask) && setLines(m_latchMask, 0);
+}
+
+void TLC5947Linux::pack(void) {
+  // Break every two channels into 3 bytes, last channel first
+  uint8_t *p = m_frame;
+  for (int16_t i = (m_numChips * CHANNELS) - 1; i >= 0; i -= 2) {
+    *p++ = (uint8_t)((m_values[i] >> 4) & 0x00FF);
+    *p++ = (uint8_t)((m_values[i] << 4) & 0x00F0) |
+      (uint8_t)((m_values[i - 1] >> 8) & 0x000F);
+    *p++ = (uint8_t)(m_values[i - 1] & 0x00FF);
+  }
+}
+
+bool TLC5947Linux::send(void) {
+  if (m_spiFd < 0) {
+    return false;
+  }
+
+  pack();
+
+  uint32_t length = m_numChips * FRAME_BYTES;
+  if (m_spiFake) {
+    return write(m_spiFd, m_frame, length) == (ssize_t)length;
+  }
+
+  // Shift the frame out in as few transfers as possible. spidev rejects
+  // messages longer than its bufsiz parameter (4096 bytes by default, or 113
+  // chips), so longer chains are split. This is safe because XLAT is only
+  // pulsed once the whole frame has been sent.
+  struct spi_ioc_transfer transfer;
+  memset(&transfer, 0, sizeof(transfer));
+  transfer.speed_hz = m_speed;
+  transfer.bits_per_word = 8;
+
+  for (uint32_t offset = 0; offset < length; offset += transfer.len) {
+    transfer.tx_buf = (uintptr_t)(m_frame + offset);
+    transfer.len = (length - offset < m_bufsiz) ? length - offset : m_bufsiz;
+
+    if (ioctl(m_spiFd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool TLC5947Linux::update(void) {
+  if (m_modified) {
+    // Shift the data out to the chips and latch it to the outputs
+    if (!send() || !latch()) {
+      return false;
+    }
+
+    // Clear the modified flag
+    m_modified = false;
+  }
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+Copyright 2015 Jordi Pakey-Rodriguez <jordi.orlando@hexa.io>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TLC5947LINUX_H
+#define TLC5947LINUX_H
+
+// This backend is only built on Linux hosts (e.g. Raspberry Pi, BeagleBone).
+// AVR builds skip it entirely.
+#if defined (__linux__)
+
+#include <stdint.h>
+
+// Declare TLC5947Linux class and its member functions
+class TLC5947Linux {
+  public:
+    TLC5947Linux(const char *spidev, const char *gpiochip, uint8_t numChips,
+      const uint32_t *latch, const uint32_t *blank,
+      uint32_t speed = 10000000);
+    ~TLC5947Linux();
+
+    bool isOpen(void);
+    uint8_t numChips(void);
+
+    uint16_t read(uint16_t channel);
+
+    void set(uint16_t channel, uint16_t value);
+    void setAll(uint16_t value);
+    void clearAll(void);
+
+    bool enable(void);
+    bool disable(void);
+    bool latch(void);
+
+    bool send(void);
+    bool update(void);
+
+  private:
+    void pack(void);
+    bool setLines(uint64_t mask, uint64_t bits);
+
+    int m_spiFd;
+    int m_gpioFd;
+    bool m_spiFake;
+    bool m_gpioFake;
+
+    uint32_t m_speed;
+    uint32_t m_bufsiz;
+
+    // Line request bitmasks for the XLAT and BLANK lines
+    uint64_t m_latchMask;
+    uint64_t m_blankMask;
+
+    bool m_modified;
+
+    uint8_t m_numChips;
+    uint16_t *m_values;
+    uint8_t *m_frame;
+};
+
+#endif
+
+#endif
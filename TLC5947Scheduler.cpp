@@ -0,0 +1,221 @@
+/*
+Copyright 2015 Jordi Pakey-Rodriguez <jordi.orlando@hexa.io>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <util/atomic.h>
+#include "TLC5947.h"
+#include "TLC5947Scheduler.h"
+
+// Static variable definitions
+// Application frame callback
+void (*TLC5947Scheduler::s_callback)(void) = 0;
+// Saved Timer1 configuration
+uint8_t TLC5947Scheduler::s_TCCR1A;
+uint8_t TLC5947Scheduler::s_TCCR1B;
+uint8_t TLC5947Scheduler::s_TIMSK1;
+uint16_t TLC5947Scheduler::s_OCR1A;
+// Timer1 prescaler of the last run, kept after end() for the statistics
+uint16_t TLC5947Scheduler::s_prescaler = 0;
+// Scheduler status flag
+bool TLC5947Scheduler::s_running = false;
+// Callback re-entrancy flag
+volatile bool TLC5947Scheduler::s_busy = false;
+// Frame statistics
+volatile uint32_t TLC5947Scheduler::s_frames = 0;
+volatile uint16_t TLC5947Scheduler::s_overruns = 0;
+volatile uint16_t TLC5947Scheduler::s_minLatency = 0xFFFF;
+volatile uint16_t TLC5947Scheduler::s_maxLatency = 0;
+volatile uint16_t TLC5947Scheduler::s_maxFrameTime = 0;
+
+bool TLC5947Scheduler::begin(uint16_t fps, void (*callback)(void)) {
+  if (!fps) {
+    return false;
+  }
+
+  // Pick the smallest prescaler that fits one frame into 16 bits
+  static const uint16_t prescalers[] = {1, 8, 64, 256, 1024};
+  uint32_t ticks = 0;
+  uint8_t i;
+  for (i = 0; i < 5; i++) {
+    ticks = F_CPU / ((uint32_t)prescalers[i] * fps);
+    if (ticks <= 0x10000) {
+      break;
+    }
+  }
+  if (i == 5 || !ticks) {
+    return false;
+  }
+
+  end();
+  s_callback = callback;
+  s_prescaler = prescalers[i];
+  resetStats();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Save the existing Timer1 configuration (e.g. the Arduino core's PWM
+    // setup for analogWrite()) so that end() can restore it
+    s_TCCR1A = TCCR1A;
+    s_TCCR1B = TCCR1B;
+    s_TIMSK1 = TIMSK1;
+    s_OCR1A = OCR1A;
+
+    // CTC mode, counting up to OCR1A
+    TCCR1A = 0;
+    TCCR1B = (1<<WGM12);
+    TCNT1 = 0;
+    OCR1A = ticks - 1;
+    // Clear any stale compare match and enable the interrupt
+    TIFR1 = (1<<OCF1A);
+    TIMSK1 |= (1<<OCIE1A);
+    // Start the timer. CS1[2:0] is 1 + the prescaler index.
+    TCCR1B |= (i + 1);
+
+    s_running = true;
+  }
+
+  return true;
+}
+
+void TLC5947Scheduler::end(void) {
+  // Nothing to restore if the scheduler isn't running
+  if (!s_running) {
+    return;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Stop the timer, then put back the configuration from before begin()
+    TCCR1B = 0;
+    TIMSK1 = s_TIMSK1;
+    TIFR1 = (1<<OCF1A);
+    TCCR1A = s_TCCR1A;
+    OCR1A = s_OCR1A;
+    TCNT1 = 0;
+    TCCR1B = s_TCCR1B;
+
+    s_running = false;
+  }
+}
+
+void TLC5947Scheduler::tick(void) {
+  // In CTC mode the counter restarts at the compare match, so its value is
+  // how long it took to get here
+  uint16_t latency = TCNT1;
+  if (latency < s_minLatency) {
+    s_minLatency = latency;
+  }
+  if (latency > s_maxLatency) {
+    s_maxLatency = latency;
+  }
+
+  // If the last frame's callback is still running, drop this frame rather
+  // than sending half-written data
+  if (s_busy) {
+    s_overruns++;
+    return;
+  }
+
+  // Latch the frame that the callback prepared last time, so that the
+  // outputs change at a steady rate regardless of how long the callback takes
+  TLC5947::update();
+  s_frames++;
+
+  uint16_t overruns = s_overruns;
+
+  if (s_callback) {
+    // Let other interrupts (and overrun detection) in while the application
+    // prepares the next frame
+    s_busy = true;
+    sei();
+    s_callback();
+    cli();
+    s_busy = false;
+  }
+
+  // Track the longest frame. If the compare matched again while we were
+  // busy (pending, or already dropped by a nested tick), the counter has
+  // wrapped and the frame overran. Clear a pending match so that the frame
+  // is dropped rather than run late.
+  uint16_t elapsed = TCNT1;
+  if (TIFR1 & (1<<OCF1A)) {
+    TIFR1 = (1<<OCF1A);
+    s_overruns++;
+  }
+  if (s_overruns != overruns) {
+    elapsed = OCR1A;
+  }
+  if (elapsed > s_maxFrameTime) {
+    s_maxFrameTime = elapsed;
+  }
+}
+
+uint32_t TLC5947Scheduler::toMicros(uint16_t ticks) {
+  // A whole frame can be over a second long at low frame rates, so this needs
+  // 32 bits. ticks * prescaler is at most 2^26 and, below 1MHz, at most F_CPU
+  // (one frame), so neither branch overflows.
+#if F_CPU >= 1000000UL
+  return ((uint32_t)ticks * s_prescaler) / (F_CPU / 1000000UL);
+#else
+  return ((uint32_t)ticks * s_prescaler * 1000UL) / (F_CPU / 1000UL);
+#endif
+}
+
+uint32_t TLC5947Scheduler::frames(void) {
+  uint32_t frames;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    frames = s_frames;
+  }
+
+  return frames;
+}
+
+uint16_t TLC5947Scheduler::overruns(void) {
+  uint16_t overruns;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    overruns = s_overruns;
+  }
+
+  return overruns;
+}
+
+uint32_t TLC5947Scheduler::jitter(void) {
+  uint16_t jitter = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (s_maxLatency >= s_minLatency) {
+      jitter = s_maxLatency - s_minLatency;
+    }
+  }
+
+  return toMicros(jitter);
+}
+
+uint32_t TLC5947Scheduler::maxFrameTime(void) {
+  uint16_t frameTime;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    frameTime = s_maxFrameTime;
+  }
+
+  return toMicros(frameTime);
+}
+
+void TLC5947Scheduler::resetStats(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    s_frames = 0;
+    s_overruns = 0;
+    s_minLatency = 0xFFFF;
+    s_maxLatency = 0;
+    s_maxFrameTime = 0;
+  }
+}
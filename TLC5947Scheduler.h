@@ -0,0 +1,71 @@
+/*
+Copyright 2015 Jordi Pakey-Rodriguez <jordi.orlando@hexa.io>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TLC5947SCHEDULER_H
+#define TLC5947SCHEDULER_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// The scheduler runs from the Timer1 compare interrupt. So that sketches that
+// don't use it can still use Timer1 themselves (e.g. Servo), the library does
+// not define that interrupt. Put TLC5947_SCHEDULER_ISR in exactly one file of
+// your sketch to use the scheduler.
+#define TLC5947_SCHEDULER_ISR \
+  ISR(TIMER1_COMPA_vect) { \
+    TLC5947Scheduler::tick(); \
+  }
+
+// Declare TLC5947Scheduler class and its member functions
+class TLC5947Scheduler {
+  public:
+    static bool begin(uint16_t fps, void (*callback)(void) = 0);
+    static void end(void);
+
+    static uint32_t frames(void);
+    static uint16_t overruns(void);
+    static uint32_t jitter(void);
+    static uint32_t maxFrameTime(void);
+    static void resetStats(void);
+
+    // Called from the timer interrupt
+    static void tick(void);
+
+  private:
+    static uint32_t toMicros(uint16_t ticks);
+
+    static void (*s_callback)(void);
+
+    // Timer1 configuration from before begin(), restored by end()
+    static uint8_t s_TCCR1A;
+    static uint8_t s_TCCR1B;
+    static uint8_t s_TIMSK1;
+    static uint16_t s_OCR1A;
+
+    static uint16_t s_prescaler;
+    static bool s_running;
+    static volatile bool s_busy;
+
+    // Frame statistics, in timer ticks
+    static volatile uint32_t s_frames;
+    static volatile uint16_t s_overruns;
+    static volatile uint16_t s_minLatency;
+    static volatile uint16_t s_maxLatency;
+    static volatile uint16_t s_maxFrameTime;
+};
+
+#endif
@@ -0,0 +1,124 @@
+// ======================================================================== //
+//  Host test for the Linux backend. No hardware is needed: the SPI device  //
+//  and GPIO chip are plain files, which TLC5947Linux treats as stand-ins.  //
+//                                                                          //
+//  Build and run from the library folder on any Linux box:                 //
+//                                                                          //
+//    g++ -Wall -Wextra -I. -o LinuxFakeDevice \                            //
+//      examples/LinuxFakeDevice/LinuxFakeDevice.cpp TLC5947Linux.cpp       //
+//    ./LinuxFakeDevice                                                     //
+//                                                                          //
+//  It exits with a non-zero status if the packed frame or the GPIO line    //
+//  changes are not what the chips expect.                                  //
+//                                                                          //
+//  For documentation, please visit https://github.com/D1SC0tech/TLC5947    //
+// ======================================================================== //
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include "TLC5947Linux.h"
+
+#define NUM_CHIPS   2
+#define FRAME_BYTES (NUM_CHIPS * 36)
+
+static int failures = 0;
+
+static void check(bool condition, const char *message) {
+  if (!condition) {
+    printf("FAIL: %s\n", message);
+    failures++;
+  }
+}
+
+// Returns the size of the given file
+static long fileSize(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return -1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+
+  return size;
+}
+
+int main() {
+  char spi[] = "/tmp/TLC5947spiXXXXXX";
+  char gpio[] = "/tmp/TLC5947gpioXXXXXX";
+  close(mkstemp(spi));
+  close(mkstemp(gpio));
+
+  // Both chips share XLAT on line 5, with BLANK on lines 6 and 7
+  const uint32_t latch[NUM_CHIPS] = {5, 5};
+  const uint32_t blank[NUM_CHIPS] = {6, 7};
+
+  {
+    TLC5947Linux TLC(spi, gpio, NUM_CHIPS, latch, blank);
+    check(TLC.isOpen(), "stand-ins were not opened");
+
+    // The constructor sends one blank frame
+    check(fileSize(spi) == FRAME_BYTES, "constructor did not send one frame");
+
+    // The last two channels of the chain are shifted out first
+    TLC.set(47, 0xABC);
+    TLC.set(46, 0x123);
+    TLC.set(0, 0x0FFF);
+    check(TLC.read(47) == 0xABC, "read() did not return the set value");
+    check(TLC.update(), "update() failed");
+
+    // Nothing changed, so this shouldn't send anything
+    check(TLC.update(), "update() failed");
+    check(fileSize(spi) == 2 * FRAME_BYTES, "update() did not send exactly one frame");
+
+    uint8_t frame[FRAME_BYTES];
+    FILE *file = fopen(spi, "rb");
+    fseek(file, FRAME_BYTES, SEEK_SET);
+    check(fread(frame, 1, FRAME_BYTES, file) == FRAME_BYTES, "frame is short");
+    fclose(file);
+
+    check(frame[0] == 0xAB && frame[1] == 0xC1 && frame[2] == 0x23,
+      "channels 47 and 46 were packed incorrectly");
+    check(frame[FRAME_BYTES - 2] == 0x0F && frame[FRAME_BYTES - 1] == 0xFF,
+      "channel 0 was packed incorrectly");
+  }
+
+  // Each line change is one record. Lines are numbered in request order:
+  // XLAT (5) is bit 0, BLANK (6) is bit 1 and BLANK (7) is bit 2.
+  const struct gpio_v2_line_values expected[] = {
+    {0x6, 0x6}, // disable()
+    {0x0, 0x1}, // XLAT low
+    {0x1, 0x1}, // latch() rising edge
+    {0x0, 0x1}, // latch() falling edge
+    {0x0, 0x6}, // enable()
+    {0x1, 0x1}, // update() rising edge
+    {0x0, 0x1}, // update() falling edge
+    {0x6, 0x6}  // destructor disable()
+  };
+  const uint8_t numExpected = sizeof(expected) / sizeof(expected[0]);
+
+  struct gpio_v2_line_values values;
+  uint8_t i = 0;
+  FILE *file = fopen(gpio, "rb");
+  while (fread(&values, sizeof(values), 1, file) == 1) {
+    if (i < numExpected) {
+      check(values.bits == expected[i].bits && values.mask == expected[i].mask,
+        "unexpected line change");
+    }
+    i++;
+  }
+  fclose(file);
+  check(i == numExpected, "wrong number of line changes");
+
+  unlink(spi);
+  unlink(gpio);
+
+  if (!failures) {
+    printf("PASS\n");
+  }
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}